@@ -0,0 +1,298 @@
+#include "acquisitionbenchmark.h"
+#include "mainwindow.h"
+#include "modbusrtu.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <algorithm>
+#include <cstring>
+
+static const int REPETITIONS = 7;
+
+//Stand-in for the bench behind MainWindow::modbusDevice. Every request is
+//answered as the bench would (0x03 with a counting value, 0x06/0x10 with the
+//echo), and the reply is announced with a queued readyRead so it reaches
+//MainWindow through the event loop the way serial data does.
+class LoopbackBench : public QIODevice {
+public:
+    LoopbackBench() : m_nextValue(0), m_requests(0) {}
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override { return m_reply.size() + QIODevice::bytesAvailable(); }
+    int requests() const { return m_requests; }
+    uint16_t lastValue() const { return static_cast<uint16_t>(m_nextValue - 1); }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        qint64 size = qMin(maxSize, static_cast<qint64>(m_reply.size()));
+        memcpy(data, m_reply.constData(), size);
+        m_reply.remove(0, size);
+        return size;
+    }
+
+    qint64 writeData(const char *data, qint64 size) override
+    {
+        QByteArray request(data, static_cast<int>(size));
+        if (request.size() < 8)
+            return size;
+        m_requests++;
+        QByteArray reply;
+        if (static_cast<uint8_t>(request.at(1)) == 0x03) {
+            reply.append(request.at(0));
+            reply.append(static_cast<char>(0x03));
+            reply.append(static_cast<char>(2));
+            reply.append(static_cast<char>((m_nextValue >> 8) & 0xFF));
+            reply.append(static_cast<char>(m_nextValue & 0xFF));
+            m_nextValue++;
+        } else {
+            reply = request.left(6);
+        }
+        uint16_t crc = ModbusRtu::calculateCRC(reply);
+        reply.append(static_cast<char>(crc & 0xFF));
+        reply.append(static_cast<char>((crc >> 8) & 0xFF));
+        m_reply.append(reply);
+        QMetaObject::invokeMethod(this, [this]() { emit readyRead(); }, Qt::QueuedConnection);
+        return size;
+    }
+
+private:
+    QByteArray m_reply;
+    uint16_t m_nextValue;
+    int m_requests;
+};
+
+//The poll path logs every read of 40016; keep that off the console while timing.
+static void quietMessageHandler(QtMsgType type, const QMessageLogContext &, const QString &message)
+{
+    if (type != QtDebugMsg)
+        QTextStream(stderr) << message << "\n";
+}
+
+AcquisitionBenchmark::AcquisitionBenchmark()
+{
+}
+
+template <typename Operation>
+double AcquisitionBenchmark::measure(int iterations, Operation operation)
+{
+    //One untimed pass to warm caches and allocators.
+    for (int i = 0; i < iterations; i++)
+        operation();
+
+    QList<double> samples;
+    QElapsedTimer timer;
+    for (int rep = 0; rep < REPETITIONS; rep++) {
+        timer.start();
+        for (int i = 0; i < iterations; i++)
+            operation();
+        samples.append(static_cast<double>(timer.nsecsElapsed()) / iterations);
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples.at(samples.size() / 2);
+}
+
+QByteArray AcquisitionBenchmark::loopbackResponse(MainWindow &window, uint16_t value)
+{
+    QByteArray response;
+    response.append(static_cast<char>(window.modbusSlaveId));
+    response.append(static_cast<char>(0x03));
+    response.append(static_cast<char>(2));
+    response.append(static_cast<char>((value >> 8) & 0xFF));
+    response.append(static_cast<char>(value & 0xFF));
+    uint16_t crc = ModbusRtu::calculateCRC(response);
+    response.append(static_cast<char>(crc & 0xFF));
+    response.append(static_cast<char>((crc >> 8) & 0xFF));
+    return response;
+}
+
+void AcquisitionBenchmark::benchmarkFrames(MainWindow &window)
+{
+    volatile uint16_t sink = 0;
+
+    QByteArray block(256, '\0');
+    for (int i = 0; i < block.size(); i++)
+        block[i] = static_cast<char>(i * 31);
+    m_results.append({"crc_256_bytes", measure(20000, [&]() {
+        sink = ModbusRtu::calculateCRC(block);
+    })});
+
+    m_results.append({"encode_read_request", measure(100000, [&]() {
+        sink = static_cast<uint16_t>(window.createModbusRequest(0x03, 40016, 1).size());
+    })});
+
+    QList<uint16_t> values;
+    values << 1 << 2 << 3 << 4;
+    m_results.append({"encode_write_multiple", measure(100000, [&]() {
+        sink = static_cast<uint16_t>(window.createModbusRequest(0x10, 40023, values.size(), 0, values).size());
+    })});
+
+    //Framing plus CRC check plus cache/UI update, as for every poll reply. The
+    //reply is matched against the transaction on the bus, so keep one there.
+    window.activeTransaction = {MainWindow::RtuOrigin::Poll, window.createModbusRequest(0x03, 40008, 1),
+                                40008, 0, 0};
+    QByteArray response = loopbackResponse(window, 1234);
+    m_results.append({"decode_read_response", measure(50000, [&]() {
+        window.transactionInFlight = true;
+        window.handleModbusData(response);
+    })});
+    window.transactionInFlight = false;
+    Q_UNUSED(sink);
+}
+
+void AcquisitionBenchmark::benchmarkPollCycle(MainWindow &window)
+{
+    //One poll from request to cache update: onUpdateTimer writes the request to
+    //the stand-in, whose reply comes back through the event loop into
+    //onSerialDataReceived, and the cycle ends when the transaction completes.
+    LoopbackBench bench;
+    if (!bench.open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+        setupFailed("poll_cycle_loopback", "unable to open the loopback device");
+        return;
+    }
+    window.modbusDevice = &bench;
+    QObject::connect(&bench, &QIODevice::readyRead, &window, &MainWindow::onSerialDataReceived);
+    window.connected = true;
+    window.lastResponseTimer.start();
+    double nsPerOp = measure(5000, [&]() {
+        window.onUpdateTimer();
+        while (window.transactionInFlight)
+            QCoreApplication::processEvents();
+    });
+    //The last poll must have been answered by the stand-in, not ended by the reply timeout.
+    bool answered = bench.requests() > 0 &&
+                    window.modbusData.value(window.currentPollRegister, -1) == bench.lastValue();
+    window.connected = false;
+    window.modbusDevice = window.serialPort;
+    if (!answered) {
+        setupFailed("poll_cycle_loopback", "polls were not answered through the loopback device");
+        return;
+    }
+    m_results.append({"poll_cycle_loopback", nsPerOp});
+}
+
+void AcquisitionBenchmark::benchmarkChannelsDialog(MainWindow &window)
+{
+    ChannelsDialog dialog(&window.modbusData);
+    dialog.m_timer->stop();
+    m_results.append({"channels_dialog_update", measure(2000, [&]() {
+        dialog.updateTable();
+    })});
+}
+
+void AcquisitionBenchmark::benchmarkLogWrite(MainWindow &window)
+{
+    QTemporaryDir dir;
+    if (!dir.isValid() || !window.openDataLog(dir.filePath("benchmark_log.csv"), -1)) {
+        setupFailed("log_write_row", "unable to create a temporary log file");
+        return;
+    }
+    m_results.append({"log_write_row", measure(2000, [&]() {
+        window.onDataLogTimerTick();
+    })});
+    //Closed here rather than with stopAutoSequence(), which would also clear a
+    //real sweep checkpoint.
+    delete window.dataLogStream;
+    window.dataLogStream = nullptr;
+    window.dataLogFile->close();
+    delete window.dataLogFile;
+    window.dataLogFile = nullptr;
+}
+
+void AcquisitionBenchmark::setupFailed(const QString &name, const QString &reason)
+{
+    QTextStream(stderr) << name << ": " << reason << "\n";
+    m_setupFailures.append(name);
+}
+
+int AcquisitionBenchmark::run(const QString &baselineFile, bool record, double maxRegressionPercent)
+{
+    QtMessageHandler previousHandler = qInstallMessageHandler(quietMessageHandler);
+    {
+        //No discovery or hotplug probing of real ports while timing.
+        MainWindow window(nullptr, false);
+        //Give every register a value so the dialog and the log format real numbers.
+        for (int reg : window.allRegisters)
+            window.modbusData[reg] = reg % 1000;
+        benchmarkFrames(window);
+        benchmarkPollCycle(window);
+        benchmarkChannelsDialog(window);
+        benchmarkLogWrite(window);
+    }
+    qInstallMessageHandler(previousHandler);
+
+    QTextStream out(stdout);
+    if (!m_setupFailures.isEmpty()) {
+        out << "FAILED: could not run " << m_setupFailures.join(", ") << "\n";
+        return 1;
+    }
+    if (record) {
+        QJsonObject cases;
+        for (const Result &result : m_results)
+            cases.insert(result.name, result.nsPerOp);
+        QJsonObject root;
+        root.insert("unit", "ns/op");
+        root.insert("cases", cases);
+        QFile file(baselineFile);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            QTextStream(stderr) << "Unable to write baseline file " << baselineFile << "\n";
+            return 2;
+        }
+        file.write(QJsonDocument(root).toJson());
+        for (const Result &result : m_results)
+            out << QString("%1 %2 ns/op\n").arg(result.name, -26).arg(result.nsPerOp, 12, 'f', 1);
+        out << "Baselines recorded to " << baselineFile << "\n";
+        return 0;
+    }
+
+    QFile file(baselineFile);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QTextStream(stderr) << "No baseline file " << baselineFile << "; run with --record first\n";
+        return 2;
+    }
+    QJsonObject baselines = QJsonDocument::fromJson(file.readAll()).object().value("cases").toObject();
+
+    bool regressed = false;
+    out << QString("%1 %2 %3 %4\n").arg("case", -26).arg("ns/op", 12).arg("baseline", 12).arg("change", 9);
+    for (const Result &result : m_results) {
+        QString line = QString("%1 %2").arg(result.name, -26).arg(result.nsPerOp, 12, 'f', 1);
+        if (!baselines.contains(result.name)) {
+            out << line << QString("%1\n").arg("(no baseline)", 13);
+            continue;
+        }
+        double baseline = baselines.value(result.name).toDouble();
+        double change = baseline > 0 ? (result.nsPerOp - baseline) * 100.0 / baseline : 0.0;
+        bool failed = change > maxRegressionPercent;
+        regressed = regressed || failed;
+        out << line << QString(" %1").arg(baseline, 12, 'f', 1)
+            << QString(" %1%").arg(change, 8, 'f', 1)
+            << (failed ? "  REGRESSION\n" : "\n");
+    }
+    //A case that has a baseline but was not measured must not pass silently.
+    QStringList missing;
+    for (const QString &name : baselines.keys()) {
+        bool measured = false;
+        for (const Result &result : m_results)
+            measured = measured || result.name == name;
+        if (!measured) {
+            missing.append(name);
+            out << QString("%1 %2\n").arg(name, -26).arg("(not measured)", 14);
+        }
+    }
+    if (regressed) {
+        out << QString("FAILED: at least one case is more than %1% slower than its baseline\n")
+                   .arg(maxRegressionPercent);
+        return 1;
+    }
+    if (!missing.isEmpty()) {
+        out << "FAILED: no measurement for " << missing.join(", ") << "\n";
+        return 1;
+    }
+    out << QString("OK: all cases within %1% of their baselines\n").arg(maxRegressionPercent);
+    return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef ACQUISITIONBENCHMARK_H
+#define ACQUISITIONBENCHMARK_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QByteArray>
+
+class MainWindow;
+
+//----------------------
+//Acquisition benchmark (run with --benchmark)
+//Times the hot paths of the acquisition loop without any hardware attached:
+//frame encode/decode and CRC, a full poll cycle through the event loop against
+//a loopback stand-in for the bench, the ChannelsDialog refresh and CSV row
+//logging. Results are compared against a baseline file and the run fails if any
+//case got slower than the allowed percentage, could not be set up, or has a
+//baseline but was not measured.
+class AcquisitionBenchmark {
+public:
+    AcquisitionBenchmark();
+
+    //Returns the process exit code: 0 when within budget (or when recording),
+    //1 when a case regressed, failed to set up or went unmeasured, 2 when the
+    //baseline file cannot be read or written.
+    int run(const QString &baselineFile, bool record, double maxRegressionPercent);
+
+private:
+    struct Result {
+        QString name;
+        double nsPerOp;
+    };
+
+    QList<Result> m_results;
+    QStringList m_setupFailures;
+
+    //Median ns per operation over several repetitions of `iterations` calls.
+    template <typename Operation>
+    double measure(int iterations, Operation operation);
+
+    void benchmarkFrames(MainWindow &window);
+    void benchmarkPollCycle(MainWindow &window);
+    void benchmarkChannelsDialog(MainWindow &window);
+    void benchmarkLogWrite(MainWindow &window);
+    void setupFailed(const QString &name, const QString &reason);
+
+    //What the bench would answer to a 0x03 read of one register.
+    static QByteArray loopbackResponse(MainWindow &window, uint16_t value);
+};
+
+#endif //ACQUISITIONBENCHMARK_H
@@ -0,0 +1,222 @@
+#include "benchdiscovery.h"
+#include "modbusrtu.h"
+
+#include <QDebug>
+
+static const uint16_t FLOWBENCH_ID_REGISTER = 40007;
+//Maestro compact protocol "Get Errors"; always answered with two bytes.
+static const char MAESTRO_GET_ERRORS = static_cast<char>(0xA1);
+//Request (8) plus 0x03 response with one register (7).
+static const int PROBE_FRAME_BYTES = 15;
+
+BenchDiscovery::BenchDiscovery(QObject *parent)
+    : QObject(parent)
+    , m_baudRates({9600, 19200, 38400, 57600, 115200})
+    , m_slaveIds({0x1C})
+    , m_probeTimeout(50)
+    , m_preferredBaudRate(0)
+    , m_preferredSlaveId(0)
+    , m_wantBench(false)
+    , m_wantMaestro(false)
+{
+}
+
+BenchDiscovery::~BenchDiscovery()
+{
+    cancel();
+}
+
+void BenchDiscovery::setBaudRates(const QList<qint32> &baudRates)
+{
+    m_baudRates = baudRates;
+}
+
+void BenchDiscovery::setSlaveIds(const QList<uint8_t> &slaveIds)
+{
+    m_slaveIds = slaveIds;
+}
+
+void BenchDiscovery::setProbeTimeout(int msec)
+{
+    m_probeTimeout = msec;
+}
+
+void BenchDiscovery::setPreferredBench(qint32 baudRate, uint8_t slaveId)
+{
+    m_preferredBaudRate = baudRate;
+    m_preferredSlaveId = slaveId;
+}
+
+bool BenchDiscovery::isRunning() const
+{
+    return !m_portProbes.isEmpty();
+}
+
+void BenchDiscovery::probePorts(const QStringList &portNames, bool wantBench, bool wantMaestro)
+{
+    m_wantBench = wantBench;
+    m_wantMaestro = wantMaestro;
+
+    //Maestro first: Modbus frames contain bytes >= 0x80 that the Maestro would
+    //take as commands, whereas a stray 0xA1 is just noise to the bench.
+    QList<Probe> probes;
+    if (wantMaestro)
+        probes.append({true, 9600, 0});
+    if (wantBench) {
+        if (m_preferredBaudRate > 0)
+            probes.append({false, m_preferredBaudRate, m_preferredSlaveId});
+        for (qint32 baudRate : m_baudRates) {
+            for (uint8_t slaveId : m_slaveIds) {
+                if (baudRate == m_preferredBaudRate && slaveId == m_preferredSlaveId)
+                    continue;
+                probes.append({false, baudRate, slaveId});
+            }
+        }
+    }
+    if (probes.isEmpty()) {
+        //Nothing to probe for (e.g. empty baud/slave lists); still report back
+        //so the caller isn't left waiting.
+        if (m_portProbes.isEmpty())
+            emit finished();
+        return;
+    }
+
+    for (const QString &portName : portNames) {
+        bool alreadyProbing = false;
+        for (const PortProbe *existing : m_portProbes) {
+            if (existing->port->portName() == portName)
+                alreadyProbing = true;
+        }
+        if (alreadyProbing)
+            continue;
+
+        PortProbe *portProbe = new PortProbe;
+        portProbe->port = new QSerialPort(portName, this);
+        portProbe->timer = new QTimer(this);
+        portProbe->timer->setSingleShot(true);
+        portProbe->probes = probes;
+        portProbe->index = -1;
+        if (!portProbe->port->open(QIODevice::ReadWrite)) {
+            //Busy (another application) or gone already; nothing to learn here.
+            delete portProbe->port;
+            delete portProbe->timer;
+            delete portProbe;
+            continue;
+        }
+        portProbe->port->setDataBits(QSerialPort::Data8);
+        portProbe->port->setParity(QSerialPort::NoParity);
+        portProbe->port->setStopBits(QSerialPort::OneStop);
+        connect(portProbe->port, &QSerialPort::readyRead, this, [this, portProbe]() {
+            onProbeReadyRead(portProbe);
+        });
+        connect(portProbe->timer, &QTimer::timeout, this, [this, portProbe]() {
+            startNextProbe(portProbe);
+        });
+        m_portProbes.append(portProbe);
+        startNextProbe(portProbe);
+    }
+    if (m_portProbes.isEmpty())
+        emit finished();
+}
+
+void BenchDiscovery::cancel()
+{
+    while (!m_portProbes.isEmpty()) {
+        PortProbe *portProbe = m_portProbes.takeFirst();
+        portProbe->timer->stop();
+        portProbe->port->close();
+        portProbe->port->deleteLater();
+        portProbe->timer->deleteLater();
+        delete portProbe;
+    }
+}
+
+void BenchDiscovery::startNextProbe(PortProbe *portProbe)
+{
+    //Skip whatever has been found elsewhere in the meantime.
+    do {
+        portProbe->index++;
+    } while (portProbe->index < portProbe->probes.size() &&
+             (portProbe->probes[portProbe->index].maestro ? !m_wantMaestro : !m_wantBench));
+    if (portProbe->index >= portProbe->probes.size()) {
+        finishPort(portProbe);
+        return;
+    }
+
+    const Probe &probe = portProbe->probes[portProbe->index];
+    portProbe->port->setBaudRate(probe.baudRate);
+    portProbe->port->clear();
+    portProbe->buffer.clear();
+    if (probe.maestro)
+        portProbe->port->write(QByteArray(1, MAESTRO_GET_ERRORS));
+    else
+        portProbe->port->write(ModbusRtu::createRequest(probe.slaveId, 0x03, FLOWBENCH_ID_REGISTER, 1));
+    //Allow for the time the frames spend on the wire at slow baud rates.
+    int frameTime = PROBE_FRAME_BYTES * 10 * 1000 / probe.baudRate + 1;
+    portProbe->timer->start(m_probeTimeout + frameTime);
+}
+
+void BenchDiscovery::onProbeReadyRead(PortProbe *portProbe)
+{
+    portProbe->buffer.append(portProbe->port->readAll());
+    if (portProbe->index < 0 || portProbe->index >= portProbe->probes.size())
+        return;
+    const Probe probe = portProbe->probes[portProbe->index];
+    QString portName = portProbe->port->portName();
+
+    if (probe.maestro) {
+        if (portProbe->buffer.size() < 2)
+            return;
+        if (portProbe->buffer.size() == 2) {
+            m_wantMaestro = false;
+            releasePort(portProbe);
+            emit maestroFound(portName);
+            emitFinishedIfDone();
+        }
+        //Anything longer is not a Maestro; let the timeout move on.
+        return;
+    }
+
+    //Expect: slave ID, 0x03, byte count 2, value hi, value lo, CRC lo, CRC hi.
+    if (portProbe->buffer.size() < 7)
+        return;
+    const QByteArray response = portProbe->buffer.left(7);
+    if (static_cast<uint8_t>(response.at(0)) != probe.slaveId ||
+        static_cast<uint8_t>(response.at(1)) != 0x03 ||
+        static_cast<uint8_t>(response.at(2)) != 2 ||
+        !ModbusRtu::checkCRC(response)) {
+        //Wrong baud rate garbles the reply; no need to wait out the timeout.
+        portProbe->timer->stop();
+        startNextProbe(portProbe);
+        return;
+    }
+    uint16_t benchId = (static_cast<uint8_t>(response.at(3)) << 8) |
+                       static_cast<uint8_t>(response.at(4));
+    m_wantBench = false;
+    releasePort(portProbe);
+    emit benchFound(portName, probe.baudRate, probe.slaveId, benchId);
+    emitFinishedIfDone();
+}
+
+void BenchDiscovery::finishPort(PortProbe *portProbe)
+{
+    releasePort(portProbe);
+    emitFinishedIfDone();
+}
+
+void BenchDiscovery::releasePort(PortProbe *portProbe)
+{
+    m_portProbes.removeOne(portProbe);
+    portProbe->timer->stop();
+    portProbe->port->close();
+    //Deleted later: we may be inside one of their signal handlers.
+    portProbe->port->deleteLater();
+    portProbe->timer->deleteLater();
+    delete portProbe;
+}
+
+void BenchDiscovery::emitFinishedIfDone()
+{
+    if (m_portProbes.isEmpty())
+        emit finished();
+}
@@ -0,0 +1,73 @@
+#ifndef BENCHDISCOVERY_H
+#define BENCHDISCOVERY_H
+
+#include <QObject>
+#include <QSerialPort>
+#include <QTimer>
+#include <QByteArray>
+#include <QStringList>
+#include <QList>
+
+//----------------------
+//Bench/servo auto-discovery
+//Opens every given port at once and walks each one through a short list of
+//probes: a Maestro "Get Errors" (0xA1) first, then a 0x03 read of FlowBench ID
+//(40007) for each baud rate / slave ID pair. Ports are probed concurrently so the
+//total time is that of the slowest port, not the sum of all of them.
+class BenchDiscovery : public QObject {
+    Q_OBJECT
+public:
+    explicit BenchDiscovery(QObject *parent = nullptr);
+    ~BenchDiscovery();
+
+    void setBaudRates(const QList<qint32> &baudRates);
+    void setSlaveIds(const QList<uint8_t> &slaveIds);
+    void setProbeTimeout(int msec);
+    //The last known good setting is tried first on every port.
+    void setPreferredBench(qint32 baudRate, uint8_t slaveId);
+
+    //Starts probing the given ports. Ports already being probed are left alone,
+    //so this can be called again for hotplugged ports while a scan is running.
+    void probePorts(const QStringList &portNames, bool wantBench, bool wantMaestro);
+    void cancel();
+    bool isRunning() const;
+
+signals:
+    //Emitted after the probe has released the port, so it can be opened right away.
+    void benchFound(const QString &portName, qint32 baudRate, uint8_t slaveId, uint16_t benchId);
+    void maestroFound(const QString &portName);
+    void finished();
+
+private:
+    struct Probe {
+        bool maestro;       //true: Maestro Get Errors, false: Modbus read of 40007
+        qint32 baudRate;
+        uint8_t slaveId;
+    };
+    struct PortProbe {
+        QSerialPort *port;
+        QTimer *timer;
+        QList<Probe> probes;
+        int index;
+        QByteArray buffer;
+    };
+
+    QList<PortProbe*> m_portProbes;
+    QList<qint32> m_baudRates;
+    QList<uint8_t> m_slaveIds;
+    int m_probeTimeout;
+    qint32 m_preferredBaudRate;
+    uint8_t m_preferredSlaveId;
+    bool m_wantBench;
+    bool m_wantMaestro;
+
+    void startNextProbe(PortProbe *portProbe);
+    void onProbeReadyRead(PortProbe *portProbe);
+    void finishPort(PortProbe *portProbe);
+    //Closes and frees the port without reporting; found signals go out between
+    //this and emitFinishedIfDone() so finished() always comes last.
+    void releasePort(PortProbe *portProbe);
+    void emitFinishedIfDone();
+};
+
+#endif //BENCHDISCOVERY_H
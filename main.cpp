@@ -1,9 +1,32 @@
 #include "mainwindow.h"
+#include "acquisitionbenchmark.h"
 #include <QApplication>
+#include <QCommandLineParser>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    //Used by QSettings, e.g. to remember the discovered bench and servo ports.
+    QCoreApplication::setOrganizationName("FlowCom");
+    QCoreApplication::setApplicationName("FlowCom Modbus Client");
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption benchmarkOption("benchmark", "Run the acquisition benchmark instead of the UI.");
+    QCommandLineOption baselineOption("baseline", "Baseline file for --benchmark.", "file", "benchmark_baselines.json");
+    QCommandLineOption recordOption("record", "Record the --benchmark results as the new baselines.");
+    QCommandLineOption maxRegressionOption("max-regression", "Allowed slowdown per case in percent.", "percent", "15");
+    parser.addOption(benchmarkOption);
+    parser.addOption(baselineOption);
+    parser.addOption(recordOption);
+    parser.addOption(maxRegressionOption);
+    parser.process(a);
+    if (parser.isSet(benchmarkOption)) {
+        AcquisitionBenchmark benchmark;
+        return benchmark.run(parser.value(baselineOption), parser.isSet(recordOption),
+                             parser.value(maxRegressionOption).toDouble());
+    }
+
     MainWindow w;
     w.show();
     return a.exec();
@@ -1,6 +1,9 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "modbusregisters.h"
+#include "modbusrtu.h"
+#include "modbustcpserver.h"
+#include "benchdiscovery.h"
 
 #include <QSerialPortInfo>
 #include <QMessageBox>
@@ -11,8 +14,19 @@
 #include <QDebug>
 #include <QDateTime>
 #include <QTimer>
+#include <QCheckBox>
+#include <QSettings>
+#include <QFileInfo>
 
-static const uint16_t MODBUS_BASE = 40001;
+//Gateway writes waiting for the bus. Beyond the limit clients are told the bench
+//is busy (0x06), and a write that waited longer than the timeout is answered with
+//0x0B rather than sent late, as the client has most likely given up on it.
+static const int GATEWAY_QUEUE_LIMIT = 8;
+static const qint64 GATEWAY_QUEUE_TIMEOUT = 2000;
+//Servo Mode, Intake/Exhaust, AutoZero, Pause and Motor On/Off belong to the
+//autosequence while it runs (and until its final Motor Off has been echoed).
+static const int SEQUENCE_CONTROL_FIRST = 40002;
+static const int SEQUENCE_CONTROL_LAST = 40006;
 
 //Implementation of ChannelsDialog
 ChannelsDialog::ChannelsDialog(QMap<int,int>* modbusData, QWidget *parent)
@@ -63,39 +77,51 @@ void ChannelsDialog::updateTable() {
     }
 }
 
-MainWindow::MainWindow(QWidget *parent)
+MainWindow::MainWindow(QWidget *parent, bool autoDiscovery)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
     , serialPort(new QSerialPort(this))
+    , modbusDevice(serialPort)
     , servoPort(new QSerialPort(this))
     , updateTimer(new QTimer(this))
     , sequenceTimer(new QTimer(this))
+    , holdTimer(new QTimer(this))
     , connected(false)
+    , modbusSlaveId(0x1C)
     , sequenceRunning(false)
+    , sequencePaused(false)
+    , motorOffPending(false)
     , currentSequenceStep(0)
     , currentServoPWM(1000)
     , dataLogFile(nullptr)
     , dataLogStream(nullptr)
     , currentPollIndex(0)
     , currentPollRegister(-1)
+    , transactionInFlight(false)
+    , pollDue(false)
+    , transactionTimer(new QTimer(this))
+    , busGuardTimer(new QTimer(this))
+    , gatewayServer(new ModbusTcpServer(&modbusData, this))
+    , discovery(new BenchDiscovery(this))
+    , portWatchTimer(new QTimer(this))
+    , benchUserDisconnected(false)
+    , servoUserDisconnected(false)
+    , reconnectTimer(new QTimer(this))
+    , servoReconnectTimer(new QTimer(this))
+    , reconnectDelay(250)
+    , servoReconnectDelay(0)
+    , modbusReconnectPending(false)
+    , servoReconnectPending(false)
+    , unansweredRequests(0)
 {
     ui->setupUi(this);
     setupUi();
 
-    //Setup servo port combo
-    ui->servoPortCombo->clear();
-    const auto servoPorts = QSerialPortInfo::availablePorts();
-    for (const QSerialPortInfo &info : servoPorts) {
-        ui->servoPortCombo->addItem(info.portName());
-    }
-    int index = ui->servoPortCombo->findText("COM4");
-    if (index != -1)
-        ui->servoPortCombo->setCurrentIndex(index);
     connect(ui->servoConnectButton, &QPushButton::clicked,
             this, &MainWindow::onServoConnectButtonClicked);
 
     //Modbus Connections
-    connect(serialPort, &QSerialPort::readyRead, this, &MainWindow::onSerialDataReceived);
+    connect(modbusDevice, &QIODevice::readyRead, this, &MainWindow::onSerialDataReceived);
     connect(updateTimer, &QTimer::timeout, this, &MainWindow::onUpdateTimer);
     connect(ui->connectButton, &QPushButton::clicked, this, &MainWindow::onConnectButtonClicked);
     connect(ui->writeButton, &QPushButton::clicked, this, &MainWindow::writeRegister);
@@ -105,6 +131,46 @@ MainWindow::MainWindow(QWidget *parent)
     connect(ui->startSequenceButton, &QPushButton::clicked, this, &MainWindow::runAutoSequence);
     connect(ui->stopSequenceButton, &QPushButton::clicked, this, &MainWindow::stopAutoSequence);
     connect(sequenceTimer, &QTimer::timeout, this, &MainWindow::onSequenceTimerTick);
+    connect(holdTimer, &QTimer::timeout, this, &MainWindow::captureAndDisablePolling);
+    sequenceTimer->setSingleShot(true);
+    holdTimer->setSingleShot(true);
+
+    //Link supervision
+    connect(serialPort, &QSerialPort::errorOccurred, this, &MainWindow::onSerialPortError);
+    connect(servoPort, &QSerialPort::errorOccurred, this, &MainWindow::onServoPortError);
+    reconnectTimer->setSingleShot(true);
+    servoReconnectTimer->setSingleShot(true);
+    connect(reconnectTimer, &QTimer::timeout, this, &MainWindow::onReconnectTimer);
+    connect(servoReconnectTimer, &QTimer::timeout, this, &MainWindow::onServoReconnectTimer);
+
+    //Modbus TCP gateway (off until enabled, loopback only)
+    connect(ui->gatewayEnableCheckBox, &QCheckBox::toggled, this, &MainWindow::onGatewayEnableToggled);
+    connect(gatewayServer, &ModbusTcpServer::writeRequested, this, &MainWindow::onGatewayWriteRequested);
+
+    //One request on the bus at a time; give up on it if the bench stays silent.
+    transactionTimer->setSingleShot(true);
+    transactionTimer->setInterval(500);
+    connect(transactionTimer, &QTimer::timeout, this, &MainWindow::onTransactionTimeout);
+    //After a timeout the bench may still answer; wait that out before the next
+    //request so the late reply can't be taken for its answer.
+    busGuardTimer->setSingleShot(true);
+    busGuardTimer->setInterval(100);
+    connect(busGuardTimer, &QTimer::timeout, this, [this]() {
+        modbusBuffer.clear();
+        dispatchNextTransaction();
+    });
+    rtuClock.start();
+
+    //Auto-discovery: probe all ports as soon as the event loop runs, then watch for hotplug.
+    connect(ui->discoverButton, &QPushButton::clicked, this, &MainWindow::startDiscovery);
+    connect(discovery, &BenchDiscovery::benchFound, this, &MainWindow::onBenchDiscovered);
+    connect(discovery, &BenchDiscovery::maestroFound, this, &MainWindow::onMaestroDiscovered);
+    connect(discovery, &BenchDiscovery::finished, this, &MainWindow::onDiscoveryFinished);
+    connect(portWatchTimer, &QTimer::timeout, this, &MainWindow::onPortWatchTimer);
+    if (autoDiscovery) {
+        portWatchTimer->start(1000);
+        QTimer::singleShot(0, this, &MainWindow::startDiscovery);
+    }
 
     updateTimer->setInterval(1000);
 
@@ -138,6 +204,16 @@ void MainWindow::setupUi()
 {
     ui->baudRateCombo->addItem("9600");
     ui->baudRateCombo->addItem("19200");
+    ui->baudRateCombo->addItem("38400");
+    ui->baudRateCombo->addItem("57600");
+    ui->baudRateCombo->addItem("115200");
+
+    //Start from the last discovered bench settings until discovery says otherwise.
+    QSettings settings;
+    int baudIndex = ui->baudRateCombo->findText(settings.value("discovery/benchBaudRate", 9600).toString());
+    if (baudIndex != -1)
+        ui->baudRateCombo->setCurrentIndex(baudIndex);
+    modbusSlaveId = static_cast<uint8_t>(settings.value("discovery/benchSlaveId", 0x1C).toInt());
 
     auto registers = ModbusRegisters::getRegisters();
     for (auto it = registers.begin(); it != registers.end(); ++it) {
@@ -148,15 +224,42 @@ void MainWindow::setupUi()
 
 void MainWindow::scanPorts()
 {
+    //Fill both port combos from a single enumeration, keeping the current
+    //selection (or the remembered one) when the port is still present.
+    QSettings settings;
+    QString benchPort = ui->portCombo->count() > 0 ? ui->portCombo->currentText()
+                                                   : settings.value("discovery/benchPort").toString();
+    QString servoPortName = ui->servoPortCombo->count() > 0 ? ui->servoPortCombo->currentText()
+                                                            : settings.value("discovery/servoPort", "COM4").toString();
     ui->portCombo->clear();
+    ui->servoPortCombo->clear();
+    knownPorts.clear();
     const auto infos = QSerialPortInfo::availablePorts();
     for (const QSerialPortInfo &info : infos) {
         ui->portCombo->addItem(info.portName());
+        ui->servoPortCombo->addItem(info.portName());
+        knownPorts.append(info.portName());
     }
+    int index = ui->portCombo->findText(benchPort);
+    if (index != -1)
+        ui->portCombo->setCurrentIndex(index);
+    index = ui->servoPortCombo->findText(servoPortName);
+    if (index != -1)
+        ui->servoPortCombo->setCurrentIndex(index);
 }
 
 void MainWindow::onConnectButtonClicked()
 {
+    if (modbusReconnectPending) {
+        //Give up on the lost link (and any link check still waiting on it).
+        reconnectTimer->stop();
+        serialPort->close();
+        failTransactions();
+        modbusReconnectPending = false;
+        benchUserDisconnected = true;
+        ui->connectButton->setText("Connect");
+        return;
+    }
     if (!connected) {
         serialPort->setPortName(ui->portCombo->currentText());
         serialPort->setBaudRate(ui->baudRateCombo->currentText().toInt());
@@ -166,61 +269,43 @@ void MainWindow::onConnectButtonClicked()
 
         if (serialPort->open(QIODevice::ReadWrite)) {
             connected = true;
+            benchUserDisconnected = false;
             ui->connectButton->setText("Disconnect");
+            unansweredRequests = 0;
+            lastResponseTimer.start();
             updateTimer->start();
+            if (motorOffPending)
+                queueModbusRequest(RtuOrigin::MotorOff, createModbusRequest(0x06, 40006, 1, 0), 40006);
+            if (sequencePaused)
+                resumeAutoSequence();
         } else {
             QMessageBox::critical(this, "Error", "Failed to open serial port");
         }
     } else {
+        //As for a lost link: the sweep waits, and nothing read before is kept.
+        pauseAutoSequence();
         updateTimer->stop();
         serialPort->close();
         connected = false;
+        modbusBuffer.clear();
+        modbusData.clear();
+        failTransactions();
+        benchUserDisconnected = true;
         ui->connectButton->setText("Connect");
     }
 }
 
 QByteArray MainWindow::createModbusRequest(uint8_t function, uint16_t registerAddr,
-                                           uint16_t numRegisters, uint16_t value)
+                                           uint16_t numRegisters, uint16_t value,
+                                           const QList<uint16_t> &values)
 {
-    QByteArray request;
-    //Use slave ID 0x1C.
-    request.append(static_cast<char>(0x1C));
-    request.append(static_cast<char>(function));
-
-    //Subtract MODBUS_BASE (40001) from the register.
-    uint16_t adjustedReg = registerAddr - MODBUS_BASE; //e.g. 40016 becomes 15
-    request.append(static_cast<char>((adjustedReg >> 8) & 0xFF));
-    request.append(static_cast<char>(adjustedReg & 0xFF));
-
-    if (function == 0x06) {
-        request.append(static_cast<char>((value >> 8) & 0xFF));
-        request.append(static_cast<char>(value & 0xFF));
-    } else {
-        request.append(static_cast<char>((numRegisters >> 8) & 0xFF));
-        request.append(static_cast<char>(numRegisters & 0xFF));
-    }
-
-    uint16_t crc = calculateCRC(request);
-    request.append(static_cast<char>(crc & 0xFF));
-    request.append(static_cast<char>((crc >> 8) & 0xFF));
-    return request;
+    //Use the bench slave ID (0x1C unless discovery found another).
+    return ModbusRtu::createRequest(modbusSlaveId, function, registerAddr, numRegisters, value, values);
 }
 
 uint16_t MainWindow::calculateCRC(const QByteArray &data)
 {
-    uint16_t crc = 0xFFFF;
-    for (int pos = 0; pos < data.size(); pos++) {
-        crc ^= static_cast<uint8_t>(data.at(pos));
-        for (int i = 0; i < 8; i++) {
-            if (crc & 0x0001) {
-                crc >>= 1;
-                crc ^= 0xA001;
-            } else {
-                crc >>= 1;
-            }
-        }
-    }
-    return crc;
+    return ModbusRtu::calculateCRC(data);
 }
 
 void MainWindow::writeRegister()
@@ -230,7 +315,7 @@ void MainWindow::writeRegister()
     int reg = ui->registerCombo->currentData().toInt();
     int value = ui->valueSpinBox->value();
     QByteArray request = createModbusRequest(0x06, reg, 1, value);
-    serialPort->write(request);
+    queueModbusRequest(RtuOrigin::Manual, request, reg);
 }
 
 void MainWindow::readRegisters()
@@ -239,16 +324,24 @@ void MainWindow::readRegisters()
         return;
     int reg = ui->registerCombo->currentData().toInt();
     QByteArray request = createModbusRequest(0x03, reg, 1);
-    serialPort->write(request);
+    queueModbusRequest(RtuOrigin::Manual, request, reg);
 }
 
 void MainWindow::onSerialDataReceived()
 {
-    modbusBuffer.append(serialPort->readAll());
+    QByteArray data = modbusDevice->readAll();
+    if (busGuardTimer->isActive())
+        return; //Late answer to a request that has timed out
+    handleModbusData(data);
+}
+
+void MainWindow::handleModbusData(const QByteArray &data)
+{
+    modbusBuffer.append(data);
     while (true) {
-        if (modbusBuffer.size() < 7)
+        if (modbusBuffer.size() < 5)
             break;
-        if (static_cast<uint8_t>(modbusBuffer.at(0)) != 0x1C) {
+        if (static_cast<uint8_t>(modbusBuffer.at(0)) != modbusSlaveId) {
             modbusBuffer.remove(0, 1);
             continue;
         }
@@ -259,8 +352,11 @@ void MainWindow::onSerialDataReceived()
                 break;
             uint8_t byteCount = static_cast<uint8_t>(modbusBuffer.at(2));
             expectedLength = 3 + byteCount + 2;
-        } else if (function == 0x06) {
+        } else if (function == 0x06 || function == 0x10) {
             expectedLength = 8;
+        } else if (function == 0x83 || function == 0x86 || function == 0x90) {
+            //Exception response: slave, function, exception code, CRC.
+            expectedLength = 5;
         } else {
             modbusBuffer.remove(0, 1);
             continue;
@@ -275,43 +371,177 @@ void MainWindow::onSerialDataReceived()
 
 void MainWindow::processModbusResponse(const QByteArray &response)
 {
-    if (response.size() < 7)
+    if (response.size() < 5)
         return;
-    uint16_t receivedCRC = (static_cast<uint8_t>(response.at(response.size()-1)) << 8) |
-                           static_cast<uint8_t>(response.at(response.size()-2));
-    QByteArray data = response.left(response.size()-2);
-    uint16_t calculatedCRC = calculateCRC(data);
-    if (receivedCRC != calculatedCRC) {
+    if (!ModbusRtu::checkCRC(response)) {
         qDebug() << "CRC error. Raw response:" << response.toHex();
         ui->statusBar->showMessage("CRC Error", 2000);
         return;
     }
+    //Any valid frame proves the link is alive.
+    unansweredRequests = 0;
+    lastResponseTimer.restart();
+    reconnectDelay = 250;
     uint8_t function = static_cast<uint8_t>(response.at(1));
+    //Only the reply to the request on the bus counts; anything else is a late
+    //answer to one that has already timed out.
+    if (!transactionInFlight || (function & 0x7F) != static_cast<uint8_t>(activeTransaction.request.at(1))) {
+        qDebug() << "Unexpected response:" << response.toHex();
+        return;
+    }
     if (function & 0x80) {
         qDebug() << "Exception response:" << response.toHex();
         ui->statusBar->showMessage("Modbus Exception", 2000);
+        completeTransaction(static_cast<uint8_t>(response.at(2)));
+        return;
+    }
+    if (function == 0x06 || function == 0x10) {
+        //The echo carries slave, function, address and value/quantity.
+        if (response.left(6) != activeTransaction.request.left(6)) {
+            qDebug() << "Unexpected write echo:" << response.toHex();
+            return;
+        }
+        completeTransaction(0);
         return;
     }
-    if (function == 0x03) {
+    if (function == 0x03 && response.size() >= 7) {
+        //A reply for a different quantity answers some other request.
+        uint16_t quantity = (static_cast<uint8_t>(activeTransaction.request.at(4)) << 8) |
+                            static_cast<uint8_t>(activeTransaction.request.at(5));
+        if (static_cast<uint8_t>(response.at(2)) != quantity * 2) {
+            qDebug() << "Unexpected read reply:" << response.toHex();
+            return;
+        }
+        int reg = activeTransaction.registerNumber;
         uint16_t value = (static_cast<uint8_t>(response.at(3)) << 8) |
                          static_cast<uint8_t>(response.at(4));
-        if (currentPollRegister == 40016)
+        if (reg == 40016)
             qDebug() << "Polled 40016. Raw response:" << response.toHex() << "Calculated value:" << value;
-        modbusData[currentPollRegister] = value;
+        modbusData[reg] = value;
         int selectedReg = ui->registerCombo->currentData().toInt();
-        if (selectedReg == currentPollRegister)
+        if (selectedReg == reg)
             ui->valueLabel->setText(QString::number(value));
+        completeTransaction(0);
     }
 }
 
 void MainWindow::onUpdateTimer()
 {
-    if (!allRegisters.isEmpty()) {
+    if (allRegisters.isEmpty())
+        return;
+    //The poll goes out as soon as the bus is free, ahead of anything queued
+    //meanwhile, so a stream of writes can't stop the values from updating.
+    pollDue = true;
+    dispatchNextTransaction();
+}
+
+bool MainWindow::queueModbusRequest(RtuOrigin origin, const QByteArray &request,
+                                    int registerNumber, quint32 gatewayToken)
+{
+    if (!connected)
+        return false;
+    rtuQueue.append({origin, request, registerNumber, gatewayToken, rtuClock.elapsed()});
+    dispatchNextTransaction();
+    return true;
+}
+
+void MainWindow::dispatchNextTransaction()
+{
+    if (transactionInFlight || busGuardTimer->isActive() || !connected)
+        return;
+    if (pollDue) {
+        pollDue = false;
         currentPollRegister = allRegisters[currentPollIndex];
-        QByteArray request = createModbusRequest(0x03, currentPollRegister, 1);
-        serialPort->write(request);
         currentPollIndex = (currentPollIndex + 1) % allRegisters.size();
+        activeTransaction = {RtuOrigin::Poll, createModbusRequest(0x03, currentPollRegister, 1),
+                             currentPollRegister, 0, rtuClock.elapsed()};
+    } else {
+        while (!rtuQueue.isEmpty() && rtuQueue.first().origin == RtuOrigin::Gateway &&
+               rtuClock.elapsed() - rtuQueue.first().queuedAt > GATEWAY_QUEUE_TIMEOUT)
+            gatewayServer->completeWrite(rtuQueue.takeFirst().gatewayToken, 0x0B);
+        if (rtuQueue.isEmpty())
+            return;
+        activeTransaction = rtuQueue.takeFirst();
     }
+    transactionInFlight = true;
+    transactionTimer->start();
+    //A failed write drops the link, which fails this transaction with the rest.
+    writeModbus(activeTransaction.request);
+}
+
+void MainWindow::completeTransaction(uint8_t exceptionCode)
+{
+    transactionTimer->stop();
+    transactionInFlight = false;
+    if (activeTransaction.origin == RtuOrigin::Gateway) {
+        gatewayServer->completeWrite(activeTransaction.gatewayToken, exceptionCode);
+    } else if (activeTransaction.origin == RtuOrigin::LinkCheck) {
+        //Any answer, even an exception, means the bench is back.
+        finishReconnect();
+    } else if (activeTransaction.origin == RtuOrigin::MotorOn && sequenceRunning && !sequencePaused) {
+        if (exceptionCode == 0) {
+            //Give the motor a second to spin up before the next step.
+            sequenceTimer->start(1000);
+        } else if (exceptionCode == 0x0B) {
+            //Not echoed; a bench that stays silent is caught by link supervision.
+            queueModbusRequest(RtuOrigin::MotorOn, createModbusRequest(0x06, 40006, 1, 1), 40006);
+        } else {
+            ui->binaryDisplay->append(QString("Flow bench refused Motor On (exception 0x%1), autosequence stopped")
+                                          .arg(exceptionCode, 2, 16, QChar('0')));
+            stopAutoSequence();
+        }
+    } else if (activeTransaction.origin == RtuOrigin::MotorOff && motorOffPending) {
+        if (exceptionCode == 0x0B) {
+            queueModbusRequest(RtuOrigin::MotorOff, createModbusRequest(0x06, 40006, 1, 0), 40006);
+        } else {
+            motorOffPending = false;
+            if (exceptionCode != 0)
+                ui->binaryDisplay->append(QString("Flow bench refused Motor Off (exception 0x%1)")
+                                              .arg(exceptionCode, 2, 16, QChar('0')));
+        }
+    }
+    dispatchNextTransaction();
+}
+
+void MainWindow::onTransactionTimeout()
+{
+    if (!transactionInFlight)
+        return;
+    if (activeTransaction.origin == RtuOrigin::LinkCheck) {
+        //The port is back but the bench isn't (yet); try again later.
+        transactionInFlight = false;
+        serialPort->close();
+        retryReconnect();
+        return;
+    }
+    //No valid reply for a while: the adapter or the bench has gone away.
+    if (++unansweredRequests >= 3 && lastResponseTimer.elapsed() > 2000) {
+        handleModbusLinkLost("No response from flow bench");
+        return;
+    }
+    //Drop whatever part of the reply has arrived; the next request waits out
+    //the guard interval (see busGuardTimer).
+    modbusBuffer.clear();
+    if (serialPort->isOpen())
+        serialPort->clear(QSerialPort::Input);
+    busGuardTimer->start();
+    completeTransaction(0x0B);
+}
+
+void MainWindow::failTransactions()
+{
+    //Nothing queued can reach the bench any more; gateway clients get told so.
+    transactionTimer->stop();
+    busGuardTimer->stop();
+    if (transactionInFlight && activeTransaction.origin == RtuOrigin::Gateway)
+        gatewayServer->completeWrite(activeTransaction.gatewayToken, 0x0B);
+    transactionInFlight = false;
+    pollDue = false;
+    for (const RtuTransaction &transaction : std::as_const(rtuQueue)) {
+        if (transaction.origin == RtuOrigin::Gateway)
+            gatewayServer->completeWrite(transaction.gatewayToken, 0x0B);
+    }
+    rtuQueue.clear();
 }
 
 QByteArray MainWindow::createMaestroCommand(int channel, int pwmValue)
@@ -332,7 +562,7 @@ void MainWindow::on_pwm1000Button_clicked()
     currentServoPWM = 1000;
     QByteArray cmd = createMaestroCommand(0, currentServoPWM);
     if (servoPort->isOpen()) {
-        servoPort->write(cmd);
+        writeServo(cmd);
         ui->binaryDisplay->append(QString("Sent PWM 1000: %1").arg(cmd.toHex(' ')));
     } else {
         QMessageBox::warning(this, "Not Connected", "Servo port not connected");
@@ -344,7 +574,7 @@ void MainWindow::on_pwm1500Button_clicked()
     currentServoPWM = 1500;
     QByteArray cmd = createMaestroCommand(0, currentServoPWM);
     if (servoPort->isOpen()) {
-        servoPort->write(cmd);
+        writeServo(cmd);
         ui->binaryDisplay->append(QString("Sent PWM 1500: %1").arg(cmd.toHex(' ')));
     } else {
         QMessageBox::warning(this, "Not Connected", "Servo port not connected");
@@ -356,7 +586,7 @@ void MainWindow::on_pwm2000Button_clicked()
     currentServoPWM = 2000;
     QByteArray cmd = createMaestroCommand(0, currentServoPWM);
     if (servoPort->isOpen()) {
-        servoPort->write(cmd);
+        writeServo(cmd);
         ui->binaryDisplay->append(QString("Sent PWM 2000: %1").arg(cmd.toHex(' ')));
     } else {
         QMessageBox::warning(this, "Not Connected", "Servo port not connected");
@@ -368,7 +598,7 @@ void MainWindow::on_incrementButton_clicked()
     currentServoPWM++;
     QByteArray cmd = createMaestroCommand(0, currentServoPWM);
     if (servoPort->isOpen()) {
-        servoPort->write(cmd);
+        writeServo(cmd);
         ui->binaryDisplay->append(QString("Sent PWM %1: %2")
                                       .arg(currentServoPWM)
                                       .arg(cmd.toHex(' ')));
@@ -379,6 +609,14 @@ void MainWindow::on_incrementButton_clicked()
 
 void MainWindow::onServoConnectButtonClicked()
 {
+    if (servoReconnectPending) {
+        //Give up on the lost link.
+        servoReconnectTimer->stop();
+        servoReconnectPending = false;
+        servoUserDisconnected = true;
+        ui->servoConnectButton->setText("Connect Servo");
+        return;
+    }
     if (!servoPort->isOpen()) {
         //Use the QComboBox "servoPortCombo" from your UI for the servo port.
         servoPort->setPortName(ui->servoPortCombo->currentText());
@@ -387,12 +625,17 @@ void MainWindow::onServoConnectButtonClicked()
         servoPort->setParity(QSerialPort::NoParity);
         servoPort->setStopBits(QSerialPort::OneStop);
         if (servoPort->open(QIODevice::ReadWrite)) {
+            servoUserDisconnected = false;
             ui->servoConnectButton->setText("Disconnect Servo");
+            if (sequencePaused)
+                resumeAutoSequence();
         } else {
             QMessageBox::critical(this, "Error", "Failed to open servo serial port");
         }
     } else {
+        pauseAutoSequence();
         servoPort->close();
+        servoUserDisconnected = true;
         ui->servoConnectButton->setText("Connect Servo");
     }
 }
@@ -400,28 +643,39 @@ void MainWindow::onServoConnectButtonClicked()
 
 void MainWindow::onSequenceTimerTick()
 {
+    if (!sequenceRunning || sequencePaused)
+        return;
+    if (!connected || !servoPort->isOpen()) {
+        pauseAutoSequence();
+        return;
+    }
     const int totalPwmSteps = ((2000 - 1000) / 10) + 1;
     if (currentSequenceStep == 0) {
-        //Step 0: Set register 40006 to 1.
-        serialPort->write(createModbusRequest(0x06, 40006, 1, 1));
-        ui->binaryDisplay->append("Autosequence Step 0: Set register 40006 to 1");
+        //Step 0: Set register 40006 to 1. Step 1 follows 1 second after the
+        //bench has echoed it (see completeTransaction).
         currentSequenceStep = 1;
-        //Wait 1 second before moving to the next step.
-        QTimer::singleShot(1000, this, SLOT(onSequenceTimerTick()));
+        queueModbusRequest(RtuOrigin::MotorOn, createModbusRequest(0x06, 40006, 1, 1), 40006);
+        ui->binaryDisplay->append("Autosequence Step 0: Set register 40006 to 1");
     } else if (currentSequenceStep == 1) {
         //Step 1: Set PWM to 1000 and hold 15 seconds.
         currentServoPWM = 1000;
-        servoPort->write(createMaestroCommand(0, currentServoPWM));
+        if (!writeServo(createMaestroCommand(0, currentServoPWM))) {
+            pauseAutoSequence();
+            return;
+        }
         ui->binaryDisplay->append("Autosequence Step 1: Set PWM to 1000");
         currentSequenceStep = 2;
         updateTimer->setInterval(50);
         updateTimer->start();
         //Wait 15 seconds before capturing data.
-        QTimer::singleShot(15000, this, SLOT(captureAndDisablePolling()));
+        holdTimer->start(15000);
     } else if (currentSequenceStep < totalPwmSteps + 1) {
         //Steps 2 to totalPwmSteps: increment PWM by 10, hold 5 seconds.
         currentServoPWM = 1000 + (currentSequenceStep - 1) * 10;
-        servoPort->write(createMaestroCommand(0, currentServoPWM));
+        if (!writeServo(createMaestroCommand(0, currentServoPWM))) {
+            pauseAutoSequence();
+            return;
+        }
         ui->binaryDisplay->append(QString("Autosequence Step %1: Set PWM to %2")
                                       .arg(currentSequenceStep)
                                       .arg(currentServoPWM));
@@ -429,14 +683,16 @@ void MainWindow::onSequenceTimerTick()
         updateTimer->setInterval(50);
         updateTimer->start();
         //Wait 5 seconds before capturing data.
-        QTimer::singleShot(5000, this, SLOT(captureAndDisablePolling()));
+        holdTimer->start(5000);
     } else if (currentSequenceStep == totalPwmSteps + 1) {
         //Final Step: Capture data, then set register 40006 to 0 and reset PWM.
+        //Motor Off is resent until the bench echoes it, across reconnects too.
         captureAndDisablePolling();
-        serialPort->write(createModbusRequest(0x06, 40006, 1, 0));
+        motorOffPending = true;
+        queueModbusRequest(RtuOrigin::MotorOff, createModbusRequest(0x06, 40006, 1, 0), 40006);
         ui->binaryDisplay->append("Autosequence Final Step: Set register 40006 to 0");
         currentServoPWM = 1000;
-        servoPort->write(createMaestroCommand(0, currentServoPWM));
+        writeServo(createMaestroCommand(0, currentServoPWM));
         ui->binaryDisplay->append("Autosequence Final Step: Reset PWM to 1000");
         stopAutoSequence();
     }
@@ -444,10 +700,18 @@ void MainWindow::onSequenceTimerTick()
 
 void MainWindow::captureAndDisablePolling()
 {
+    //A hold interrupted by a lost link is redone after reconnecting, never logged.
+    if (sequencePaused)
+        return;
+    if (!connected || !servoPort->isOpen()) {
+        pauseAutoSequence();
+        return;
+    }
     onDataLogTimerTick();
+    saveCheckpoint();
     updateTimer->stop();
     //Delay a short moment (100ms) then trigger the next sequence step.
-    QTimer::singleShot(100, this, SLOT(onSequenceTimerTick()));
+    sequenceTimer->start(100);
 }
 
 void MainWindow::onDataLogTimerTick()
@@ -475,9 +739,11 @@ void MainWindow::onDataLogTimerTick()
 
 void MainWindow::runAutoSequence()
 {
-    if (!connected)
+    if (!connected || sequenceRunning)
         return;
     sequenceRunning = true;
+    sequencePaused = false;
+    motorOffPending = false; //The new sweep switches the motor on itself
     currentSequenceStep = 0;
 
     //Retrieve metadata from UI fields:
@@ -485,40 +751,166 @@ void MainWindow::runAutoSequence()
     if(csvFileName.isEmpty()) {
         csvFileName = "autosequence_log.csv";
     }
-    QString serialNumber = ui->serialNumberLineEdit->text();
-    QString csvType = ui->csvTypeComboBox->currentText();
 
-    //Open the CSV file using the specified (or default) file name.
-    dataLogFile = new QFile(csvFileName);
-    if (dataLogFile->open(QIODevice::WriteOnly | QIODevice::Text)) {
-        dataLogStream = new QTextStream(dataLogFile);
-
-        //Write metadata as header comments (optional):
-        *dataLogStream << "# Serial Number: " << serialNumber << "\n";
-        *dataLogStream << "# CSV Type: " << csvType << "\n";
-
-        //Write the column header row.
-        auto regs = ModbusRegisters::getRegisters();
-        QStringList header;
-        header << "PWM" << "Timestamp";
-        //Use the register name instead of the register number.
-        for (auto it = regs.begin(); it != regs.end(); ++it) {
-            header << it.value().name;
+    //An interrupted sweep into the same file can pick up where it stopped, as
+    //long as the file still holds everything up to the checkpoint. A deleted,
+    //replaced or shortened log can't be resumed; start a fresh one instead.
+    QSettings settings;
+    qint64 resumeOffset = -1;
+    QFileInfo logInfo(csvFileName);
+    bool checkpointForLog = settings.contains("checkpoint/logFile") &&
+                            settings.value("checkpoint/logFile").toString() == logInfo.absoluteFilePath();
+    if (checkpointForLog &&
+        (!logInfo.exists() || logInfo.size() < settings.value("checkpoint/logOffset").toLongLong())) {
+        ui->binaryDisplay->append(QString("%1 no longer matches the last checkpoint, starting a new log")
+                                      .arg(csvFileName));
+        clearCheckpoint();
+        checkpointForLog = false;
+    }
+    if (checkpointForLog) {
+        int step = settings.value("checkpoint/step").toInt();
+        int pwm = settings.value("checkpoint/pwm").toInt();
+        if (QMessageBox::question(this, "Resume Autosequence",
+                                  QString("The last sweep into %1 was interrupted before step %2 (PWM %3).\n"
+                                          "Resume it instead of starting over?")
+                                      .arg(csvFileName).arg(step).arg(pwm)) == QMessageBox::Yes) {
+            currentSequenceStep = step;
+            currentServoPWM = pwm;
+            resumeOffset = settings.value("checkpoint/logOffset").toLongLong();
         }
-        *dataLogStream << header.join(",") << "\n";
-        dataLogStream->flush();
-    } else {
+    }
+
+    if (!openDataLog(csvFileName, resumeOffset)) {
         QMessageBox::warning(this, "Log Error", "Unable to open CSV log file for writing.");
     }
+    saveCheckpoint();
+    if (resumeOffset >= 0) {
+        ui->binaryDisplay->append(QString("Autosequence resuming at step %1").arg(currentSequenceStep));
+        resumeAutoSequence();
+        return;
+    }
     //Kick off the autosequence immediately.
-    QTimer::singleShot(0, this, SLOT(onSequenceTimerTick()));
+    sequenceTimer->start(0);
+}
+
+bool MainWindow::openDataLog(const QString &fileName, qint64 resumeOffset)
+{
+    dataLogFile = new QFile(fileName);
+    if (resumeOffset >= 0) {
+        //Drop anything written after the last good capture, then append.
+        if (!dataLogFile->open(QIODevice::ReadWrite | QIODevice::Text) ||
+            !dataLogFile->resize(resumeOffset) || !dataLogFile->seek(resumeOffset)) {
+            delete dataLogFile;
+            dataLogFile = nullptr;
+            return false;
+        }
+        dataLogStream = new QTextStream(dataLogFile);
+        return true;
+    }
+
+    //Open the CSV file using the specified (or default) file name.
+    if (!dataLogFile->open(QIODevice::WriteOnly | QIODevice::Text)) {
+        delete dataLogFile;
+        dataLogFile = nullptr;
+        return false;
+    }
+    dataLogStream = new QTextStream(dataLogFile);
+
+    //Write metadata as header comments (optional):
+    *dataLogStream << "# Serial Number: " << ui->serialNumberLineEdit->text() << "\n";
+    *dataLogStream << "# CSV Type: " << ui->csvTypeComboBox->currentText() << "\n";
+
+    //Write the column header row.
+    auto regs = ModbusRegisters::getRegisters();
+    QStringList header;
+    header << "PWM" << "Timestamp";
+    //Use the register name instead of the register number.
+    for (auto it = regs.begin(); it != regs.end(); ++it) {
+        header << it.value().name;
+    }
+    *dataLogStream << header.join(",") << "\n";
+    dataLogStream->flush();
+    return true;
+}
+
+void MainWindow::saveCheckpoint()
+{
+    //The step to run next, the PWM it follows on from and the log size up to the
+    //last good row. Saved after every capture so a resume redoes at most one step.
+    QSettings settings;
+    if (dataLogFile) {
+        dataLogStream->flush();
+        dataLogFile->flush();
+        settings.setValue("checkpoint/logFile", QFileInfo(dataLogFile->fileName()).absoluteFilePath());
+        settings.setValue("checkpoint/logOffset", dataLogFile->size());
+    }
+    settings.setValue("checkpoint/step", currentSequenceStep);
+    settings.setValue("checkpoint/pwm", currentServoPWM);
+}
+
+void MainWindow::clearCheckpoint()
+{
+    QSettings settings;
+    settings.remove("checkpoint");
+}
+
+void MainWindow::pauseAutoSequence()
+{
+    if (!sequenceRunning || sequencePaused)
+        return;
+    sequencePaused = true;
+    sequenceTimer->stop();
+    holdTimer->stop();
+    updateTimer->stop();
+    ui->binaryDisplay->append(QString("Autosequence paused at step %1").arg(currentSequenceStep));
 }
 
+void MainWindow::resumeAutoSequence()
+{
+    if (!sequenceRunning)
+        return;
+    if (!connected || !servoPort->isOpen()) {
+        //Picked up again once both links are up.
+        sequencePaused = true;
+        ui->binaryDisplay->append("Autosequence waiting for the flow bench and servo links");
+        return;
+    }
+    QSettings settings;
+    if (settings.contains("checkpoint/step")) {
+        currentSequenceStep = settings.value("checkpoint/step").toInt();
+        currentServoPWM = settings.value("checkpoint/pwm").toInt();
+    }
+    if (dataLogFile && settings.contains("checkpoint/logOffset")) {
+        //Discard rows logged after the checkpoint (e.g. with stale values).
+        qint64 offset = settings.value("checkpoint/logOffset").toLongLong();
+        dataLogStream->flush();
+        if (dataLogFile->size() > offset) {
+            dataLogFile->resize(offset);
+            dataLogFile->seek(offset);
+        }
+    }
+    sequencePaused = false;
+    ui->binaryDisplay->append(QString("Autosequence resumed at step %1").arg(currentSequenceStep));
+    if (currentSequenceStep >= 1) {
+        //Restore the bench and servo to where the sweep left off. As after step 0,
+        //the sweep carries on once the bench has echoed Motor On.
+        if (!writeServo(createMaestroCommand(0, currentServoPWM))) {
+            pauseAutoSequence();
+            return;
+        }
+        queueModbusRequest(RtuOrigin::MotorOn, createModbusRequest(0x06, 40006, 1, 1), 40006);
+    } else {
+        sequenceTimer->start(0);
+    }
+}
 
 void MainWindow::stopAutoSequence()
 {
     sequenceRunning = false;
+    sequencePaused = false;
     sequenceTimer->stop();
+    holdTimer->stop();
+    clearCheckpoint();
     if (dataLogStream) {
         dataLogStream->flush();
         delete dataLogStream;
@@ -536,3 +928,332 @@ void MainWindow::onViewChannelsButtonClicked()
     ChannelsDialog *dialog = new ChannelsDialog(&modbusData, this);
     dialog->exec();
 }
+
+void MainWindow::onGatewayEnableToggled(bool enabled)
+{
+    if (enabled) {
+        quint16 port = static_cast<quint16>(ui->gatewayPortSpinBox->value());
+        if (gatewayServer->listen(QHostAddress::LocalHost, port)) {
+            ui->gatewayPortSpinBox->setEnabled(false);
+            ui->statusBar->showMessage(QString("Modbus TCP gateway listening on 127.0.0.1:%1").arg(port), 2000);
+        } else {
+            QMessageBox::critical(this, "Error",
+                                  QString("Failed to start Modbus TCP gateway: %1").arg(gatewayServer->errorString()));
+            ui->gatewayEnableCheckBox->setChecked(false);
+        }
+    } else {
+        gatewayServer->close();
+        //Writes still waiting for the bus have no one to answer to any more.
+        rtuQueue.removeIf([](const RtuTransaction &transaction) {
+            return transaction.origin == RtuOrigin::Gateway;
+        });
+        ui->gatewayPortSpinBox->setEnabled(true);
+    }
+}
+
+void MainWindow::onGatewayWriteRequested(quint32 token, uint8_t function, uint16_t registerAddr,
+                                         const QList<uint16_t> &values)
+{
+    if (!connected) {
+        gatewayServer->completeWrite(token, 0x0B);
+        return;
+    }
+    if ((sequenceRunning || motorOffPending) && registerAddr <= SEQUENCE_CONTROL_LAST &&
+        registerAddr + values.size() - 1 >= SEQUENCE_CONTROL_FIRST) {
+        gatewayServer->completeWrite(token, 0x06);
+        return;
+    }
+    int queuedWrites = 0;
+    for (const RtuTransaction &transaction : std::as_const(rtuQueue)) {
+        if (transaction.origin == RtuOrigin::Gateway)
+            queuedWrites++;
+    }
+    if (queuedWrites >= GATEWAY_QUEUE_LIMIT) {
+        gatewayServer->completeWrite(token, 0x06);
+        return;
+    }
+    QByteArray request;
+    if (function == 0x06)
+        request = createModbusRequest(0x06, registerAddr, 1, values.first());
+    else
+        request = createModbusRequest(0x10, registerAddr, values.size(), 0, values);
+    queueModbusRequest(RtuOrigin::Gateway, request, registerAddr, token);
+}
+
+void MainWindow::startDiscovery()
+{
+    //Only look for a link that has never connected or is waiting to reconnect
+    //(if its adapter comes back under another name, the old port never will).
+    //Never touch our own ports: open, closed while a reconnect is pending, or
+    //disconnected by the user, who decides when that link comes back.
+    bool wantBench = !connected && !benchUserDisconnected;
+    bool wantMaestro = !servoPort->isOpen() && !servoUserDisconnected;
+    if (!wantBench && !wantMaestro)
+        return;
+    QStringList ports;
+    const auto infos = QSerialPortInfo::availablePorts();
+    for (const QSerialPortInfo &info : infos) {
+        if (((connected || modbusReconnectPending || benchUserDisconnected) &&
+             info.portName() == serialPort->portName()) ||
+            ((servoPort->isOpen() || servoReconnectPending || servoUserDisconnected) &&
+             info.portName() == servoPort->portName()))
+            continue;
+        ports.append(info.portName());
+    }
+
+    //Baud rates and slave IDs come from the settings so other benches can be added
+    //without a rebuild; the defaults cover everything the bench firmware offers.
+    QSettings settings;
+    QList<qint32> baudRates;
+    const QStringList baudList = settings.value("discovery/baudRates", "9600,19200,38400,57600,115200").toString().split(',');
+    for (const QString &baud : baudList) {
+        if (baud.trimmed().toInt() > 0)
+            baudRates.append(baud.trimmed().toInt());
+    }
+    QList<uint8_t> slaveIds;
+    const QStringList slaveList = settings.value("discovery/slaveIds", "28").toString().split(',');
+    for (const QString &slave : slaveList) {
+        int id = slave.trimmed().toInt();
+        if (id >= 1 && id <= 247)
+            slaveIds.append(static_cast<uint8_t>(id));
+    }
+    discovery->setBaudRates(baudRates);
+    discovery->setSlaveIds(slaveIds);
+    discovery->setProbeTimeout(settings.value("discovery/probeTimeoutMs", 50).toInt());
+    if (settings.contains("discovery/benchBaudRate"))
+        discovery->setPreferredBench(settings.value("discovery/benchBaudRate").toInt(),
+                                     static_cast<uint8_t>(settings.value("discovery/benchSlaveId", 0x1C).toInt()));
+
+    ui->discoverButton->setEnabled(false);
+    ui->statusBar->showMessage("Searching for flow bench and servo controller...");
+    discovery->probePorts(ports, wantBench, wantMaestro);
+}
+
+void MainWindow::onBenchDiscovered(const QString &portName, qint32 baudRate, uint8_t slaveId, uint16_t benchId)
+{
+    ui->binaryDisplay->append(QString("Found flow bench (ID %1) on %2 at %3 baud, slave ID 0x%4")
+                                  .arg(benchId)
+                                  .arg(portName)
+                                  .arg(baudRate)
+                                  .arg(slaveId, 2, 16, QChar('0')));
+    QSettings settings;
+    settings.setValue("discovery/benchPort", portName);
+    settings.setValue("discovery/benchBaudRate", baudRate);
+    settings.setValue("discovery/benchSlaveId", slaveId);
+    //The user may have disconnected the bench while the probe ran; connecting it
+    //again here would also resume a sweep they paused that way.
+    if (connected || benchUserDisconnected)
+        return;
+    modbusSlaveId = slaveId;
+    int index = ui->portCombo->findText(portName);
+    if (index == -1) {
+        ui->portCombo->addItem(portName);
+        index = ui->portCombo->count() - 1;
+    }
+    ui->portCombo->setCurrentIndex(index);
+    index = ui->baudRateCombo->findText(QString::number(baudRate));
+    if (index == -1) {
+        ui->baudRateCombo->addItem(QString::number(baudRate));
+        index = ui->baudRateCombo->count() - 1;
+    }
+    ui->baudRateCombo->setCurrentIndex(index);
+    if (modbusReconnectPending) {
+        //Move the reconnect over to where the bench turned up, dropping any link
+        //check still waiting on the old port.
+        if (transactionInFlight) {
+            transactionTimer->stop();
+            transactionInFlight = false;
+        }
+        serialPort->close();
+        serialPort->setPortName(portName);
+        serialPort->setBaudRate(baudRate);
+        reconnectTimer->start(0);
+        return;
+    }
+    onConnectButtonClicked();
+}
+
+void MainWindow::onMaestroDiscovered(const QString &portName)
+{
+    ui->binaryDisplay->append(QString("Found Maestro servo controller on %1").arg(portName));
+    QSettings settings;
+    settings.setValue("discovery/servoPort", portName);
+    if (servoPort->isOpen() || servoUserDisconnected)
+        return;
+    int index = ui->servoPortCombo->findText(portName);
+    if (index == -1) {
+        ui->servoPortCombo->addItem(portName);
+        index = ui->servoPortCombo->count() - 1;
+    }
+    ui->servoPortCombo->setCurrentIndex(index);
+    if (servoReconnectPending) {
+        servoPort->setPortName(portName);
+        servoReconnectTimer->start(0);
+        return;
+    }
+    onServoConnectButtonClicked();
+}
+
+void MainWindow::onDiscoveryFinished()
+{
+    ui->discoverButton->setEnabled(true);
+    if (connected && servoPort->isOpen())
+        ui->statusBar->showMessage("Flow bench and servo controller connected", 2000);
+    else if (!connected)
+        ui->statusBar->showMessage("Flow bench not found", 2000);
+    else
+        ui->statusBar->showMessage("Servo controller not found", 2000);
+}
+
+void MainWindow::onPortWatchTimer()
+{
+    QStringList ports;
+    const auto infos = QSerialPortInfo::availablePorts();
+    for (const QSerialPortInfo &info : infos)
+        ports.append(info.portName());
+    if (ports == knownPorts)
+        return;
+    bool portAdded = false;
+    for (const QString &port : ports) {
+        if (!knownPorts.contains(port))
+            portAdded = true;
+    }
+    scanPorts();
+    //A newly plugged adapter may be the bench or servo we're still missing.
+    if (portAdded && ((!connected && !benchUserDisconnected) ||
+                      (!servoPort->isOpen() && !servoUserDisconnected)))
+        startDiscovery();
+}
+
+bool MainWindow::writeModbus(const QByteArray &request)
+{
+    if (!connected)
+        return false;
+    if (modbusDevice->write(request) == -1) {
+        handleModbusLinkLost(modbusDevice->errorString());
+        return false;
+    }
+    return true;
+}
+
+bool MainWindow::writeServo(const QByteArray &command)
+{
+    if (!servoPort->isOpen())
+        return false;
+    if (servoPort->write(command) == -1) {
+        handleServoLinkLost(servoPort->errorString());
+        return false;
+    }
+    return true;
+}
+
+void MainWindow::onSerialPortError(QSerialPort::SerialPortError error)
+{
+    if (error == QSerialPort::ResourceError || error == QSerialPort::WriteError ||
+        error == QSerialPort::ReadError || error == QSerialPort::DeviceNotFoundError)
+        handleModbusLinkLost(serialPort->errorString());
+}
+
+void MainWindow::onServoPortError(QSerialPort::SerialPortError error)
+{
+    if (error == QSerialPort::ResourceError || error == QSerialPort::WriteError ||
+        error == QSerialPort::ReadError || error == QSerialPort::DeviceNotFoundError)
+        handleServoLinkLost(servoPort->errorString());
+}
+
+void MainWindow::handleModbusLinkLost(const QString &reason)
+{
+    if (!connected || modbusReconnectPending)
+        return;
+    qDebug() << "Modbus link lost:" << reason;
+    ui->binaryDisplay->append(QString("Modbus link lost (%1), reconnecting...").arg(reason));
+    pauseAutoSequence();
+    updateTimer->stop();
+    serialPort->close();
+    connected = false;
+    modbusBuffer.clear();
+    //Values read before the drop must not end up in the log or the gateway.
+    modbusData.clear();
+    failTransactions();
+    modbusReconnectPending = true;
+    ui->connectButton->setText("Cancel Reconnect");
+    reconnectTimer->start(reconnectDelay);
+}
+
+void MainWindow::handleServoLinkLost(const QString &reason)
+{
+    if (!servoPort->isOpen() || servoReconnectPending)
+        return;
+    qDebug() << "Servo link lost:" << reason;
+    ui->binaryDisplay->append(QString("Servo link lost (%1), reconnecting...").arg(reason));
+    pauseAutoSequence();
+    servoPort->close();
+    servoReconnectPending = true;
+    servoReconnectDelay = 250;
+    ui->servoConnectButton->setText("Reconnecting Servo...");
+    servoReconnectTimer->start(servoReconnectDelay);
+}
+
+void MainWindow::onReconnectTimer()
+{
+    if (!modbusReconnectPending)
+        return;
+    //Port name, baud rate and framing are still set from the original connect.
+    if (!serialPort->open(QIODevice::ReadWrite)) {
+        retryReconnect();
+        return;
+    }
+    //An open port only proves the adapter is back; the link is up once the bench
+    //answers a read of FlowBench ID.
+    modbusBuffer.clear();
+    activeTransaction = {RtuOrigin::LinkCheck, createModbusRequest(0x03, 40007, 1), 40007, 0, rtuClock.elapsed()};
+    transactionInFlight = true;
+    transactionTimer->start();
+    if (serialPort->write(activeTransaction.request) == -1) {
+        transactionTimer->stop();
+        transactionInFlight = false;
+        serialPort->close();
+        retryReconnect();
+    }
+}
+
+void MainWindow::retryReconnect()
+{
+    reconnectDelay = qMin(reconnectDelay * 2, 8000);
+    reconnectTimer->start(reconnectDelay);
+}
+
+void MainWindow::finishReconnect()
+{
+    modbusReconnectPending = false;
+    connected = true;
+    ui->connectButton->setText("Disconnect");
+    ui->binaryDisplay->append("Modbus link re-established");
+    unansweredRequests = 0;
+    if (motorOffPending)
+        queueModbusRequest(RtuOrigin::MotorOff, createModbusRequest(0x06, 40006, 1, 0), 40006);
+    if (sequencePaused) {
+        resumeAutoSequence();
+    } else if (!sequenceRunning) {
+        updateTimer->setInterval(1000);
+        updateTimer->start();
+    }
+}
+
+void MainWindow::onServoReconnectTimer()
+{
+    if (!servoReconnectPending)
+        return;
+    if (!servoPort->open(QIODevice::ReadWrite)) {
+        servoReconnectDelay = qMin(servoReconnectDelay * 2, 8000);
+        servoReconnectTimer->start(servoReconnectDelay);
+        return;
+    }
+    servoReconnectPending = false;
+    ui->servoConnectButton->setText("Disconnect Servo");
+    ui->binaryDisplay->append("Servo link re-established");
+    if (sequencePaused)
+        resumeAutoSequence();
+    else
+        writeServo(createMaestroCommand(0, currentServoPWM));
+}
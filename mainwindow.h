@@ -12,6 +12,10 @@
 #include <QList>
 #include <QDialog>
 #include <QTableWidget>
+#include <QElapsedTimer>
+
+class ModbusTcpServer;
+class BenchDiscovery;
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -29,6 +33,7 @@ struct ChannelInfo {
 //Live Channels Dialog
 class ChannelsDialog : public QDialog {
     Q_OBJECT
+    friend class AcquisitionBenchmark;
 public:
     explicit ChannelsDialog(QMap<int,int>* modbusData, QWidget *parent = nullptr);
 private slots:
@@ -45,9 +50,12 @@ private:
 //MainWindow Declaration
 class MainWindow : public QMainWindow {
     Q_OBJECT
+    friend class AcquisitionBenchmark; //Drives the acquisition paths directly (--benchmark)
 
 public:
-    explicit MainWindow(QWidget *parent = nullptr);
+    //autoDiscovery: probe the serial ports at startup and on hotplug. Off for
+    //--benchmark, which must never touch real ports.
+    explicit MainWindow(QWidget *parent = nullptr, bool autoDiscovery = true);
     ~MainWindow();
 
 private slots:
@@ -79,14 +87,39 @@ private slots:
     //New: View Channels slot.
     void onViewChannelsButtonClicked();
 
+    //Modbus TCP gateway slots:
+    void onGatewayEnableToggled(bool enabled);
+    void onGatewayWriteRequested(quint32 token, uint8_t function, uint16_t registerAddr,
+                                 const QList<uint16_t> &values);
+
+    void onTransactionTimeout(); //No reply to the request on the bus
+
+    //Bench/servo auto-discovery slots:
+    void startDiscovery();
+    void onBenchDiscovered(const QString &portName, qint32 baudRate, uint8_t slaveId, uint16_t benchId);
+    void onMaestroDiscovered(const QString &portName);
+    void onDiscoveryFinished();
+    void onPortWatchTimer(); //Hotplug detection
+
+    //Link supervision and automatic reconnect:
+    void onSerialPortError(QSerialPort::SerialPortError error);
+    void onServoPortError(QSerialPort::SerialPortError error);
+    void onReconnectTimer();
+    void onServoReconnectTimer();
+
 private:
     Ui::MainWindow *ui;
     //Modbus-related members:
     QSerialPort *serialPort;
+    QIODevice *modbusDevice;  //Where RTU frames are written and read; serialPort except under --benchmark
     QTimer *updateTimer;      //Used for polling Modbus registers
     QTimer *sequenceTimer;    //Used for the autosequence steps
+    QTimer *holdTimer;        //Hold period of the current autosequence step
     bool connected;
+    uint8_t modbusSlaveId;    //Slave ID of the flow bench (0x1C unless discovered otherwise)
     bool sequenceRunning;
+    bool sequencePaused;      //Link lost mid-sweep; waiting to resume from the checkpoint
+    bool motorOffPending;     //Final Motor Off not echoed yet; resent whenever the bench link comes up
     int currentSequenceStep;  //Tracks which step of the autosequence we're in
 
     //For sequentially polling all registers:
@@ -116,12 +149,81 @@ private:
     //For storing the latest Modbus register values:
     QMap<int,int> modbusData;  //key: register number, value: last read value
 
+    //RTU transactions. Everything sent to the bench (polls, manual reads/writes,
+    //autosequence writes and gateway writes) goes through one queue, and the next
+    //request only goes out once the one on the bus is answered or has timed out.
+    //MotorOn/MotorOff are the autosequence's writes of 40006, whose echoes it waits
+    //on; LinkCheck is the 40007 read that must be answered before a reopened port
+    //counts as connected.
+    enum class RtuOrigin { Poll, Manual, Gateway, MotorOn, MotorOff, LinkCheck };
+    struct RtuTransaction {
+        RtuOrigin origin;
+        QByteArray request;
+        int registerNumber;     //First register addressed; where a 0x03 reply is stored
+        quint32 gatewayToken;   //Gateway writes only
+        qint64 queuedAt;        //rtuClock time; stale gateway writes are dropped
+    };
+    QList<RtuTransaction> rtuQueue;
+    RtuTransaction activeTransaction;
+    bool transactionInFlight;
+    bool pollDue;               //A poll tick came while the bus was busy
+    QTimer *transactionTimer;   //Reply timeout of the request on the bus
+    QTimer *busGuardTimer;      //Quiet period after a timeout; late replies are dropped
+    QElapsedTimer rtuClock;
+
+    //Modbus TCP gateway (writes are queued as RtuOrigin::Gateway transactions).
+    ModbusTcpServer *gatewayServer;
+
+    //Auto-discovery of the bench and Maestro ports:
+    BenchDiscovery *discovery;
+    QTimer *portWatchTimer;    //Polls the port list, QSerialPortInfo has no hotplug signal
+    QStringList knownPorts;    //Port names seen on the last scan
+    //Set when the user disconnects a link (or cancels its reconnect) and cleared
+    //when they connect it again: discovery leaves such a link and its port alone.
+    bool benchUserDisconnected;
+    bool servoUserDisconnected;
+
+    //Link supervision: a port error, a failed write or no valid reply for a while
+    //marks the link as lost, and it is reopened with exponential backoff.
+    QTimer *reconnectTimer;
+    QTimer *servoReconnectTimer;
+    int reconnectDelay;        //ms, doubled after every failed attempt, reset by a valid reply
+    int servoReconnectDelay;
+    bool modbusReconnectPending;
+    bool servoReconnectPending;
+    int unansweredRequests;
+    QElapsedTimer lastResponseTimer;
+
     void setupUi();
     void scanPorts();
     QByteArray createModbusRequest(uint8_t function, uint16_t registerAddr,
-                                   uint16_t numRegisters = 1, uint16_t value = 0);
+                                   uint16_t numRegisters = 1, uint16_t value = 0,
+                                   const QList<uint16_t> &values = QList<uint16_t>());
     uint16_t calculateCRC(const QByteArray &data);
+    void handleModbusData(const QByteArray &data); //Frames and processes received bytes
     void processModbusResponse(const QByteArray &response);
+    bool queueModbusRequest(RtuOrigin origin, const QByteArray &request,
+                            int registerNumber, quint32 gatewayToken = 0);
+    void dispatchNextTransaction();
+    //exceptionCode is 0 for a good reply, the bench's exception code, or 0x0B
+    //when nothing came back.
+    void completeTransaction(uint8_t exceptionCode);
+    void failTransactions();
+
+    //All bus traffic goes through these so a failed write is noticed.
+    bool writeModbus(const QByteArray &request);
+    bool writeServo(const QByteArray &command);
+    void handleModbusLinkLost(const QString &reason);
+    void handleServoLinkLost(const QString &reason);
+    void retryReconnect();
+    void finishReconnect();
+
+    //Autosequence checkpoint (persisted in QSettings under "checkpoint/"):
+    bool openDataLog(const QString &fileName, qint64 resumeOffset);
+    void saveCheckpoint();
+    void clearCheckpoint();
+    void pauseAutoSequence();
+    void resumeAutoSequence();
 
     //Maestro command creation:
     QByteArray createMaestroCommand(int channel, int pwmValue);
@@ -0,0 +1,63 @@
+#include "modbusrtu.h"
+
+QByteArray ModbusRtu::createRequest(uint8_t slaveId, uint8_t function, uint16_t registerAddr,
+                                    uint16_t numRegisters, uint16_t value,
+                                    const QList<uint16_t> &values)
+{
+    QByteArray request;
+    request.append(static_cast<char>(slaveId));
+    request.append(static_cast<char>(function));
+
+    //Subtract MODBUS_BASE (40001) from the register.
+    uint16_t adjustedReg = registerAddr - MODBUS_BASE; //e.g. 40016 becomes 15
+    request.append(static_cast<char>((adjustedReg >> 8) & 0xFF));
+    request.append(static_cast<char>(adjustedReg & 0xFF));
+
+    if (function == 0x06) {
+        request.append(static_cast<char>((value >> 8) & 0xFF));
+        request.append(static_cast<char>(value & 0xFF));
+    } else if (function == 0x10) {
+        //Write multiple registers: quantity, byte count, then the values.
+        request.append(static_cast<char>((values.size() >> 8) & 0xFF));
+        request.append(static_cast<char>(values.size() & 0xFF));
+        request.append(static_cast<char>(values.size() * 2));
+        for (uint16_t v : values) {
+            request.append(static_cast<char>((v >> 8) & 0xFF));
+            request.append(static_cast<char>(v & 0xFF));
+        }
+    } else {
+        request.append(static_cast<char>((numRegisters >> 8) & 0xFF));
+        request.append(static_cast<char>(numRegisters & 0xFF));
+    }
+
+    uint16_t crc = calculateCRC(request);
+    request.append(static_cast<char>(crc & 0xFF));
+    request.append(static_cast<char>((crc >> 8) & 0xFF));
+    return request;
+}
+
+uint16_t ModbusRtu::calculateCRC(const QByteArray &data)
+{
+    uint16_t crc = 0xFFFF;
+    for (int pos = 0; pos < data.size(); pos++) {
+        crc ^= static_cast<uint8_t>(data.at(pos));
+        for (int i = 0; i < 8; i++) {
+            if (crc & 0x0001) {
+                crc >>= 1;
+                crc ^= 0xA001;
+            } else {
+                crc >>= 1;
+            }
+        }
+    }
+    return crc;
+}
+
+bool ModbusRtu::checkCRC(const QByteArray &frame)
+{
+    if (frame.size() < 3)
+        return false;
+    uint16_t receivedCRC = (static_cast<uint8_t>(frame.at(frame.size()-1)) << 8) |
+                           static_cast<uint8_t>(frame.at(frame.size()-2));
+    return receivedCRC == calculateCRC(frame.left(frame.size()-2));
+}
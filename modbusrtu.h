@@ -0,0 +1,26 @@
+#ifndef MODBUSRTU_H
+#define MODBUSRTU_H
+
+#include <QByteArray>
+#include <QList>
+
+//Register numbers are 4xxxx; frames carry the zero-based offset from this.
+static const uint16_t MODBUS_BASE = 40001;
+
+//----------------------
+//Modbus RTU framing shared by MainWindow, BenchDiscovery and the TCP gateway,
+//so every path (and the benchmark) builds and checks frames the same way.
+class ModbusRtu {
+public:
+    //Builds a complete request frame including the CRC. registerAddr is the
+    //4xxxx register number. 0x06 sends `value`, 0x10 sends `values`, anything
+    //else (0x03) sends `numRegisters`.
+    static QByteArray createRequest(uint8_t slaveId, uint8_t function, uint16_t registerAddr,
+                                    uint16_t numRegisters = 1, uint16_t value = 0,
+                                    const QList<uint16_t> &values = QList<uint16_t>());
+    static uint16_t calculateCRC(const QByteArray &data);
+    //True if the last two bytes are the CRC of the rest of the frame.
+    static bool checkCRC(const QByteArray &frame);
+};
+
+#endif //MODBUSRTU_H
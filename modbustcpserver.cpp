@@ -0,0 +1,265 @@
+#include "modbustcpserver.h"
+#include "modbusregisters.h"
+#include "modbusrtu.h"
+
+#include <QDebug>
+
+//MBAP header: transaction ID (2), protocol ID (2), length (2), unit ID (1).
+static const int MBAP_HEADER_SIZE = 7;
+//Largest PDU allowed by the Modbus spec.
+static const int MAX_PDU_SIZE = 253;
+
+//Modbus exception codes used by the gateway.
+static const uint8_t EXCEPTION_ILLEGAL_FUNCTION = 0x01;
+static const uint8_t EXCEPTION_ILLEGAL_ADDRESS = 0x02;
+static const uint8_t EXCEPTION_ILLEGAL_VALUE = 0x03;
+static const uint8_t EXCEPTION_TARGET_NO_RESPONSE = 0x0B;
+
+static uint16_t readUInt16(const QByteArray &data, int pos)
+{
+    return (static_cast<uint8_t>(data.at(pos)) << 8) | static_cast<uint8_t>(data.at(pos + 1));
+}
+
+static void appendUInt16(QByteArray &data, uint16_t value)
+{
+    data.append(static_cast<char>((value >> 8) & 0xFF));
+    data.append(static_cast<char>(value & 0xFF));
+}
+
+ModbusTcpServer::ModbusTcpServer(QMap<int,int>* modbusData, QObject *parent)
+    : QObject(parent)
+    , m_server(new QTcpServer(this))
+    , m_modbusData(modbusData)
+    , m_nextToken(1)
+{
+    connect(m_server, &QTcpServer::newConnection, this, &ModbusTcpServer::onNewConnection);
+}
+
+ModbusTcpServer::~ModbusTcpServer()
+{
+    close();
+}
+
+bool ModbusTcpServer::listen(const QHostAddress &address, quint16 port)
+{
+    return m_server->listen(address, port);
+}
+
+void ModbusTcpServer::close()
+{
+    m_server->close();
+    const auto clients = m_buffers.keys();
+    for (QTcpSocket *client : clients) {
+        client->disconnect(this);
+        client->abort();
+        client->deleteLater();
+    }
+    m_buffers.clear();
+    m_pendingWrites.clear();
+}
+
+bool ModbusTcpServer::isListening() const
+{
+    return m_server->isListening();
+}
+
+QString ModbusTcpServer::errorString() const
+{
+    return m_server->errorString();
+}
+
+int ModbusTcpServer::clientCount() const
+{
+    return m_buffers.size();
+}
+
+void ModbusTcpServer::onNewConnection()
+{
+    while (m_server->hasPendingConnections()) {
+        QTcpSocket *client = m_server->nextPendingConnection();
+        m_buffers.insert(client, QByteArray());
+        connect(client, &QTcpSocket::readyRead, this, &ModbusTcpServer::onClientReadyRead);
+        connect(client, &QTcpSocket::disconnected, this, &ModbusTcpServer::onClientDisconnected);
+    }
+}
+
+void ModbusTcpServer::onClientDisconnected()
+{
+    QTcpSocket *client = qobject_cast<QTcpSocket*>(sender());
+    if (!client)
+        return;
+    //Any write still pending for this client is answered into the void; the
+    //QPointer in PendingWrite takes care of that.
+    m_buffers.remove(client);
+    client->deleteLater();
+}
+
+void ModbusTcpServer::onClientReadyRead()
+{
+    QTcpSocket *client = qobject_cast<QTcpSocket*>(sender());
+    if (!client || !m_buffers.contains(client))
+        return;
+    QByteArray &buffer = m_buffers[client];
+    buffer.append(client->readAll());
+    while (buffer.size() >= MBAP_HEADER_SIZE) {
+        uint16_t protocolId = readUInt16(buffer, 2);
+        uint16_t length = readUInt16(buffer, 4);
+        //Length counts the unit ID plus the PDU.
+        if (protocolId != 0 || length < 2 || length > MAX_PDU_SIZE + 1) {
+            qDebug() << "Modbus TCP: malformed MBAP header, dropping client";
+            client->abort();
+            return;
+        }
+        int frameLength = 6 + length;
+        if (buffer.size() < frameLength)
+            break;
+        QByteArray adu = buffer.left(frameLength);
+        buffer.remove(0, frameLength);
+        processRequest(client, adu);
+    }
+}
+
+void ModbusTcpServer::processRequest(QTcpSocket *client, const QByteArray &adu)
+{
+    QByteArray header = adu.left(MBAP_HEADER_SIZE);
+    QByteArray pdu = adu.mid(MBAP_HEADER_SIZE);
+    uint8_t function = static_cast<uint8_t>(pdu.at(0));
+    switch (function) {
+    case 0x03:
+        handleReadHoldingRegisters(client, header, pdu);
+        break;
+    case 0x06:
+        handleWriteSingleRegister(client, header, pdu);
+        break;
+    case 0x10:
+        handleWriteMultipleRegisters(client, header, pdu);
+        break;
+    default:
+        sendException(client, header, function, EXCEPTION_ILLEGAL_FUNCTION);
+        break;
+    }
+}
+
+void ModbusTcpServer::handleReadHoldingRegisters(QTcpSocket *client, const QByteArray &header, const QByteArray &pdu)
+{
+    if (pdu.size() != 5) {
+        sendException(client, header, 0x03, EXCEPTION_ILLEGAL_VALUE);
+        return;
+    }
+    uint16_t address = readUInt16(pdu, 1);
+    uint16_t quantity = readUInt16(pdu, 3);
+    if (quantity < 1 || quantity > 125) {
+        sendException(client, header, 0x03, EXCEPTION_ILLEGAL_VALUE);
+        return;
+    }
+
+    //Reads are answered from the cache only; the RTU bus is never touched.
+    auto registers = ModbusRegisters::getRegisters();
+    QByteArray response;
+    response.append(static_cast<char>(0x03));
+    response.append(static_cast<char>(quantity * 2));
+    for (int i = 0; i < quantity; i++) {
+        int regNumber = MODBUS_BASE + address + i;
+        if (!registers.contains(regNumber)) {
+            sendException(client, header, 0x03, EXCEPTION_ILLEGAL_ADDRESS);
+            return;
+        }
+        int value = m_modbusData->value(regNumber, -1);
+        if (value == -1) {
+            //Not polled yet (or link lost); don't hand out made-up values.
+            sendException(client, header, 0x03, EXCEPTION_TARGET_NO_RESPONSE);
+            return;
+        }
+        appendUInt16(response, static_cast<uint16_t>(value));
+    }
+    sendResponse(client, header, response);
+}
+
+void ModbusTcpServer::handleWriteSingleRegister(QTcpSocket *client, const QByteArray &header, const QByteArray &pdu)
+{
+    if (pdu.size() != 5) {
+        sendException(client, header, 0x06, EXCEPTION_ILLEGAL_VALUE);
+        return;
+    }
+    uint16_t address = readUInt16(pdu, 1);
+    uint16_t value = readUInt16(pdu, 3);
+    if (!isWritableRange(address, 1)) {
+        sendException(client, header, 0x06, EXCEPTION_ILLEGAL_ADDRESS);
+        return;
+    }
+    quint32 token = m_nextToken++;
+    m_pendingWrites.insert(token, {client, header, 0x06, address, value});
+    emit writeRequested(token, 0x06, MODBUS_BASE + address, QList<uint16_t>() << value);
+}
+
+void ModbusTcpServer::handleWriteMultipleRegisters(QTcpSocket *client, const QByteArray &header, const QByteArray &pdu)
+{
+    if (pdu.size() < 6) {
+        sendException(client, header, 0x10, EXCEPTION_ILLEGAL_VALUE);
+        return;
+    }
+    uint16_t address = readUInt16(pdu, 1);
+    uint16_t quantity = readUInt16(pdu, 3);
+    uint8_t byteCount = static_cast<uint8_t>(pdu.at(5));
+    if (quantity < 1 || quantity > 123 || byteCount != quantity * 2 || pdu.size() != 6 + byteCount) {
+        sendException(client, header, 0x10, EXCEPTION_ILLEGAL_VALUE);
+        return;
+    }
+    if (!isWritableRange(address, quantity)) {
+        sendException(client, header, 0x10, EXCEPTION_ILLEGAL_ADDRESS);
+        return;
+    }
+    QList<uint16_t> values;
+    for (int i = 0; i < quantity; i++)
+        values.append(readUInt16(pdu, 6 + i * 2));
+    quint32 token = m_nextToken++;
+    m_pendingWrites.insert(token, {client, header, 0x10, address, quantity});
+    emit writeRequested(token, 0x10, MODBUS_BASE + address, values);
+}
+
+bool ModbusTcpServer::isWritableRange(uint16_t address, uint16_t quantity) const
+{
+    auto registers = ModbusRegisters::getRegisters();
+    for (int i = 0; i < quantity; i++) {
+        int regNumber = MODBUS_BASE + address + i;
+        if (!registers.contains(regNumber) || registers.value(regNumber).readOnly)
+            return false;
+    }
+    return true;
+}
+
+void ModbusTcpServer::completeWrite(quint32 token, uint8_t exceptionCode)
+{
+    if (!m_pendingWrites.contains(token))
+        return;
+    PendingWrite pending = m_pendingWrites.take(token);
+    if (!pending.client)
+        return;
+    if (exceptionCode != 0) {
+        sendException(pending.client, pending.header, pending.function, exceptionCode);
+        return;
+    }
+    //Both 0x06 and 0x10 answer with function, address and a second 16-bit field.
+    QByteArray response;
+    response.append(static_cast<char>(pending.function));
+    appendUInt16(response, pending.address);
+    appendUInt16(response, pending.quantity);
+    sendResponse(pending.client, pending.header, response);
+}
+
+void ModbusTcpServer::sendResponse(QTcpSocket *client, const QByteArray &header, const QByteArray &pdu)
+{
+    QByteArray adu = header.left(4);
+    appendUInt16(adu, static_cast<uint16_t>(pdu.size() + 1));
+    adu.append(header.at(6)); //Unit ID
+    adu.append(pdu);
+    client->write(adu);
+}
+
+void ModbusTcpServer::sendException(QTcpSocket *client, const QByteArray &header, uint8_t function, uint8_t exceptionCode)
+{
+    QByteArray pdu;
+    pdu.append(static_cast<char>(function | 0x80));
+    pdu.append(static_cast<char>(exceptionCode));
+    sendResponse(client, header, pdu);
+}
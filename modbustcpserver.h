@@ -0,0 +1,71 @@
+#ifndef MODBUSTCPSERVER_H
+#define MODBUSTCPSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QPointer>
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QList>
+
+//----------------------
+//Modbus TCP gateway
+//Serves 0x03 reads straight from the cached register values so external tools
+//never touch the RTU bus. 0x06/0x10 writes are handed to MainWindow through
+//writeRequested() and answered once completeWrite() reports the RTU outcome.
+class ModbusTcpServer : public QObject {
+    Q_OBJECT
+public:
+    explicit ModbusTcpServer(QMap<int,int>* modbusData, QObject *parent = nullptr);
+    ~ModbusTcpServer();
+
+    bool listen(const QHostAddress &address = QHostAddress::LocalHost, quint16 port = 502);
+    void close();
+    bool isListening() const;
+    QString errorString() const;
+    int clientCount() const;
+
+public slots:
+    //Called by MainWindow once the forwarded write has been echoed (or has failed)
+    //on the RTU bus. exceptionCode is 0 on success, otherwise a Modbus exception code.
+    void completeWrite(quint32 token, uint8_t exceptionCode);
+
+signals:
+    //registerAddr is the 4xxxx register number, as used by createModbusRequest.
+    void writeRequested(quint32 token, uint8_t function, uint16_t registerAddr,
+                        const QList<uint16_t> &values);
+
+private slots:
+    void onNewConnection();
+    void onClientReadyRead();
+    void onClientDisconnected();
+
+private:
+    //A forwarded write waiting for the RTU bus to answer.
+    struct PendingWrite {
+        QPointer<QTcpSocket> client;
+        QByteArray header;   //MBAP header of the request
+        uint8_t function;
+        uint16_t address;    //Zero-based, as received
+        uint16_t quantity;   //Value for 0x06, register count for 0x10
+    };
+
+    QTcpServer *m_server;
+    QMap<int,int>* m_modbusData;
+    QHash<QTcpSocket*, QByteArray> m_buffers;
+    QHash<quint32, PendingWrite> m_pendingWrites;
+    quint32 m_nextToken;
+
+    void processRequest(QTcpSocket *client, const QByteArray &adu);
+    void handleReadHoldingRegisters(QTcpSocket *client, const QByteArray &header, const QByteArray &pdu);
+    void handleWriteSingleRegister(QTcpSocket *client, const QByteArray &header, const QByteArray &pdu);
+    void handleWriteMultipleRegisters(QTcpSocket *client, const QByteArray &header, const QByteArray &pdu);
+    bool isWritableRange(uint16_t address, uint16_t quantity) const;
+    void sendResponse(QTcpSocket *client, const QByteArray &header, const QByteArray &pdu);
+    void sendException(QTcpSocket *client, const QByteArray &header, uint8_t function, uint8_t exceptionCode);
+};
+
+#endif //MODBUSTCPSERVER_H